@@ -123,6 +123,10 @@
 #  undef  MPI_TIME
 # endif
 # undef  AUTOTILING
+                      /* Timers around the hot routines (region_timers.F) */
+# undef  REGION_TIMERS
+                      /* Hardware counters of the timed routines (roofline) */
+# undef  REGION_COUNTERS
                       /* Non-hydrostatic options */
 # ifdef NBQ
 #  define W_HADV_TVD
@@ -221,10 +221,34 @@
 !
       integer NSUB_X, NSUB_E, NPP
 #ifdef MPI
+! NP_XI_BUILD and NP_ETA_BUILD are passed by compile_test as -D flags, so this
+! file does not change with the core count
+# ifndef NP_XI_BUILD
+#  define NP_XI_BUILD 1
+# endif
+# ifndef NP_ETA_BUILD
+#  define NP_ETA_BUILD 1
+# endif
       integer NP_XI, NP_ETA, NNODES
-      parameter (NP_XI=,  NP_ETA=,  NNODES=NP_XI*NP_ETA)
+      parameter (NP_XI=NP_XI_BUILD,  NP_ETA=NP_ETA_BUILD,  NNODES=NP_XI*NP_ETA)
+# ifdef OPENMP
+! Hybrid MPI+OpenMP: NPP_BUILD threads per rank share its tile, split in
+! NSUB_X_BUILD x NSUB_E_BUILD sub-tiles (compile_test, autotune_tiles)
+#  ifndef NPP_BUILD
+#   define NPP_BUILD 1
+#  endif
+#  ifndef NSUB_X_BUILD
+#   define NSUB_X_BUILD 1
+#  endif
+#  ifndef NSUB_E_BUILD
+#   define NSUB_E_BUILD NPP_BUILD
+#  endif
+      parameter (NPP=NPP_BUILD)
+      parameter (NSUB_X=NSUB_X_BUILD, NSUB_E=NSUB_E_BUILD)
+# else
       parameter (NPP=1)
       parameter (NSUB_X=1, NSUB_E=1)
+# endif
 #elif defined OPENMP
       parameter (NPP=64)
 # ifdef AUTOTILING
@@ -0,0 +1,127 @@
+/*
+ * Region counters: hardware counters of the timed regions (REGION_COUNTERS, see
+ * region_timers.F)
+ *
+ * Every thread opens its perf_event groups on itself the first time it reads, with
+ * the events of REGION_COUNTERS_EVENTS: up to RC_GROUPS groups separated by ';',
+ * each a comma separated list of "<type>:<config>" pairs (perf_event_attr type and
+ * config, decimal or 0x hex), RC_EVENTS in all, e.g. "0:3;4:0x1c7,4:0x4c7" for
+ * cache-misses and two raw events. The events of a group are scheduled together,
+ * so a group must fit the general purpose counters of a core (4 with hyper-threading
+ * on Intel); the kernel multiplexes the groups. roofline resolves event names to
+ * these pairs. User space only, so perf_event_paranoid 2 is enough.
+ *
+ * region_counters_read (values) fills the RC_MAX integer*8 values of the thread so
+ * far: the RC_EVENTS counts in the order of the list (zero for unused slots), the
+ * time the groups were enabled, then the time each group was running (ns). Counts
+ * scale by enabled/running; a group that never ran was not scheduled, and when a
+ * group could not be opened its slots stay zero.
+ */
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RC_EVENTS 6
+#define RC_GROUPS 2
+#define RC_MAX (RC_EVENTS + 1 + RC_GROUPS)
+
+static __thread int rc_opened = 0;
+static __thread int rc_leader[RC_GROUPS];
+static __thread int rc_nevents[RC_GROUPS];
+static int rc_warned = 0;
+
+static int open_event(uint32_t type, uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void warn_once(const char *message, const char *event)
+{
+    if (__sync_bool_compare_and_swap(&rc_warned, 0, 1))
+        fprintf(stderr, "region_counters: %s%s%s, counters stay zero\n", message,
+                event ? " " : "", event ? event : "");
+}
+
+/* Open the groups of the calling thread from REGION_COUNTERS_EVENTS */
+static void open_groups(void)
+{
+    const char *spec = getenv("REGION_COUNTERS_EVENTS");
+    char list[512], *group, *item, *group_save = NULL, *save = NULL;
+    int g, total = 0;
+
+    rc_opened = 1;
+    for (g = 0; g < RC_GROUPS; g++) {
+        rc_leader[g] = -1;
+        rc_nevents[g] = 0;
+    }
+    if (!spec || !*spec) {
+        warn_once("REGION_COUNTERS_EVENTS is not set", NULL);
+        return;
+    }
+    strncpy(list, spec, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    for (g = 0, group = strtok_r(list, ";", &group_save); group && g < RC_GROUPS;
+         g++, group = strtok_r(NULL, ";", &group_save)) {
+        for (item = strtok_r(group, ",", &save); item && total < RC_EVENTS;
+             item = strtok_r(NULL, ",", &save)) {
+            char *colon = strchr(item, ':');
+            int fd;
+            if (!colon) {
+                warn_once("malformed event (expected <type>:<config>)", item);
+                break;
+            }
+            fd = open_event((uint32_t) strtoul(item, NULL, 0), strtoull(colon + 1, NULL, 0), rc_leader[g]);
+            if (fd < 0) {
+                warn_once("cannot open event", item);
+                break;
+            }
+            if (rc_leader[g] < 0)
+                rc_leader[g] = fd;
+            rc_nevents[g]++;
+            total++;
+        }
+    }
+    for (g = 0; g < RC_GROUPS; g++) {
+        if (rc_leader[g] >= 0) {
+            ioctl(rc_leader[g], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(rc_leader[g], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+}
+
+void region_counters_read_(long long *values)
+{
+    uint64_t buffer[RC_EVENTS + 3];
+    int g, i, slot = 0;
+
+    for (i = 0; i < RC_MAX; i++)
+        values[i] = 0;
+    if (!rc_opened)
+        open_groups();
+    for (g = 0; g < RC_GROUPS; g++) {
+        /* nr, time enabled, time running, then the counts of the group */
+        if (rc_leader[g] >= 0 &&
+            read(rc_leader[g], buffer, sizeof(uint64_t) * (rc_nevents[g] + 3)) > 0) {
+            for (i = 0; i < (int) buffer[0] && i < rc_nevents[g]; i++)
+                values[slot + i] = (long long) buffer[i + 3];
+            if (values[RC_EVENTS] == 0)
+                values[RC_EVENTS] = (long long) buffer[1];
+            values[RC_EVENTS + 1 + g] = (long long) buffer[2];
+        }
+        slot += rc_nevents[g];
+    }
+}
@@ -0,0 +1,25 @@
+! Region timers (REGION_TIMERS, see region_timers.F)
+!
+! Per-thread accumulators of the time spent in each timed region, in ticks of
+! the monotonic clock of system_clock, and the number of calls. The first
+! dimension is padded so that the accumulators of different threads do not
+! share cache lines. NREGIONS comes from region_timers_list.h, which jobcomp
+! generates together with the wrapped call sites.
+!
+! With REGION_COUNTERS the hardware counters of each thread (RC_MAX values:
+! the event counts, then the enabled and running times of their groups, see
+! region_counters.c) are accumulated per region the same way.
+!
+#include "region_timers_list.h"
+      integer RT_PAD
+      parameter (RT_PAD=NREGIONS+8)
+      integer*8 rt_ticks(RT_PAD,0:NPP-1), rt_start(RT_PAD,0:NPP-1),
+     &          rt_calls(RT_PAD,0:NPP-1)
+      common /region_timers_acc/ rt_ticks, rt_start, rt_calls
+#ifdef REGION_COUNTERS
+      integer RC_MAX
+      parameter (RC_MAX=9)
+      integer*8 rc_counts(RC_MAX,RT_PAD,0:NPP-1),
+     &          rc_start(RC_MAX,RT_PAD,0:NPP-1)
+      common /region_counters_acc/ rc_counts, rc_start
+#endif
@@ -0,0 +1,209 @@
+import argparse
+import math
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+# Per-rank memory model of a CROCO build.
+#
+# param.h is preprocessed with the test's cppdefs.h and the MPI decomposition, its
+# parameters are evaluated, and the memory of the model arrays is counted in units of
+# one 2D field (Lm+4+padd_X by Mm+4+padd_E doubles, the GLOBAL_2D_ARRAY extent) and one
+# 3D field (the same times N). The field counts are approximate: they cover the
+# prognostic, diagnostic, forcing and mixing arrays of a regional configuration. The
+# private scratch arrays A2d/A3d are sized exactly from NSA, N2d, N3d and NPP. Measured
+# RSS (track_rss) calibrates the model with one factor, the median of measured/predicted.
+# The MPI and OPENMP keys of cppdefs.h pick the branch of param.h: without MPI the run is
+# one process (NNODES is not defined) of NPP threads, which cannot use more than one node.
+
+BYTES_PER_VALUE = 8
+BASE_MB = 200.0          # executable, MPI and netCDF libraries, I/O buffers
+FIELDS_2D = 150          # 2D arrays (barotropic mode, forcing, grid metrics, ...)
+FIELDS_3D = 45           # 3D arrays besides tracers (u, v, Hz, z_r, z_w, rho, Akv, ...)
+FIELDS_3D_PER_TRACER = 5 # t (3 time levels), climatology, nudging and mixing per tracer
+SCRATCH_3D = 5           # A3d(N3d, 5, 0:NPP-1)
+
+
+def preprocess(param_file, cppdefs_file, np_xi, np_eta, defines, include_dirs):
+    # cppdefs.h includes cppdefs_dev.h and set_global_definitions.h from the CROCO sources;
+    # they are only kept when found, the configuration keys are all in cppdefs.h itself
+    lines = []
+    with open(cppdefs_file) as f:
+        for line in f:
+            match = re.match(r'\s*#\s*include\s+"([^"]+)"', line)
+            if match and not any(os.path.exists(os.path.join(d, match.group(1))) for d in include_dirs):
+                continue
+            lines.append(line)
+    with open(param_file) as f:
+        lines.extend(f.readlines())
+
+    with tempfile.NamedTemporaryFile("w", suffix=".F", delete=False) as tmp:
+        tmp.writelines(lines)
+        source = tmp.name
+    try:
+        command = ["cpp", "-P", "-traditional-cpp",
+                   "-DNP_XI_BUILD=%d" % np_xi, "-DNP_ETA_BUILD=%d" % np_eta]
+        command += ["-D" + d for d in defines]
+        command += ["-I" + d for d in include_dirs]
+        result = subprocess.run(command + [source], capture_output=True, text=True)
+    finally:
+        os.unlink(source)
+    if result.returncode != 0:
+        sys.exit("Error: preprocessing %s failed:\n%s" % (param_file, result.stderr))
+    return result.stdout
+
+
+def split_top_level(text):
+    parts, depth, current = [], 0, ""
+    for char in text:
+        if char == "(":
+            depth += 1
+        elif char == ")":
+            depth -= 1
+        if char == "," and depth == 0:
+            parts.append(current)
+            current = ""
+        else:
+            current += char
+    parts.append(current)
+    return parts
+
+
+def evaluate_parameters(source):
+    # Join fixed-form (& in column 6) and free-form (trailing &) continuation lines
+    statements = []
+    for line in source.splitlines():
+        line = line.split("!")[0].rstrip()
+        if not line.strip():
+            continue
+        if len(line) > 5 and line[5] == "&" and line[:5].strip() == "" and statements:
+            statements[-1] += line[6:]
+        elif statements and statements[-1].endswith("&"):
+            statements[-1] = statements[-1][:-1] + line
+        else:
+            statements.append(line)
+
+    values = {}
+    for statement in statements:
+        match = re.match(r"\s*parameter\s*\((.*)\)\s*$", statement, re.IGNORECASE)
+        if not match:
+            continue
+        for assignment in split_top_level(match.group(1)):
+            if "=" not in assignment:
+                continue
+            name, expression = assignment.split("=", 1)
+            # Integer arithmetic: Fortran division of positive integers is floor division
+            expression = re.sub(r"(?<![/])/(?![/])", "//", expression.lower())
+            try:
+                values[name.strip().lower()] = eval(expression, {"__builtins__": {}}, dict(values))
+            except Exception:
+                pass
+    return values
+
+
+def calibration_factor(calibration_file):
+    ratios = []
+    if calibration_file and os.path.exists(calibration_file):
+        with open(calibration_file) as f:
+            for line in f:
+                if line.startswith("#"):
+                    continue
+                fields = line.rstrip("\n").split("\t")
+                try:
+                    predicted, measured = float(fields[4]), float(fields[5])
+                except (IndexError, ValueError):
+                    continue
+                if predicted > 0 and measured > 0:
+                    ratios.append(measured / predicted)
+    if not ratios:
+        return 1.0, 0
+    ratios.sort()
+    middle = len(ratios) // 2
+    median = ratios[middle] if len(ratios) % 2 else (ratios[middle - 1] + ratios[middle]) / 2
+    return median, len(ratios)
+
+
+def rank_memory_mb(p):
+    lm, mm, n = p["lm"], p["mm"], p["n"]
+    points_2d = (lm + 4 + p.get("padd_x", 0)) * (mm + 4 + p.get("padd_e", 0))
+    points_3d = points_2d * (n + 1)
+    tracers = p.get("nt", 2)
+    npp = p.get("npp", 1)
+
+    values = points_2d * FIELDS_2D
+    values += points_3d * (FIELDS_3D + FIELDS_3D_PER_TRACER * tracers)
+    if "n2d" in p and "n3d" in p:
+        values += (p["n2d"] * p.get("nsa", 28) + p["n3d"] * SCRATCH_3D) * npp
+    return BASE_MB + values * BYTES_PER_VALUE / 2.0 ** 20
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Predict the per-rank and per-node memory of a CROCO build.")
+    parser.add_argument("--param", required=True)
+    parser.add_argument("--cppdefs", required=True)
+    parser.add_argument("--np-xi", type=int, default=1)
+    parser.add_argument("--np-eta", type=int, default=1)
+    parser.add_argument("--define", action="append", default=[], help="build flag, e.g. NPP_BUILD=4")
+    parser.add_argument("--include", action="append", default=[])
+    parser.add_argument("--calibration")
+    parser.add_argument("--tasks-per-node", type=int, default=128)
+    parser.add_argument("--node-memory-gb", type=float, default=512)
+    parser.add_argument("--safety-factor", type=float, default=1.2)
+    parser.add_argument("--raw", action="store_true", help="print only the uncalibrated per-rank prediction in MB")
+    args = parser.parse_args()
+
+    include_dirs = [d for d in args.include if os.path.isdir(d)]
+    parameters = evaluate_parameters(preprocess(args.param, args.cppdefs, args.np_xi, args.np_eta, args.define,
+                                                include_dirs))
+    missing = [name for name in ("lm", "mm", "n") if name not in parameters]
+    if missing:
+        sys.exit("Error: could not evaluate %s from %s." % (", ".join(missing), args.param))
+
+    raw_mb = rank_memory_mb(parameters)
+    if args.raw:
+        print("%.0f" % raw_mb)
+        return 0
+
+    factor, samples = calibration_factor(args.calibration)
+    mpi = "nnodes" in parameters
+    ranks = parameters["nnodes"] if mpi else 1
+    rank_mb = raw_mb * factor
+    ranks_per_node = min(args.tasks_per_node, ranks)
+    node_mb = rank_mb * ranks_per_node
+    usable_mb = args.node_memory_gb * 1024 / args.safety_factor
+
+    grid = "Grid: %d x %d x %d, %d tracers" % (
+        parameters.get("llm", 0), parameters.get("mmm", 0), parameters["n"], parameters.get("nt", 0))
+    if mpi:
+        print("%s, decomposition %d x %d (%d x %d points per rank)" % (
+            grid, parameters.get("np_xi", 1), parameters.get("np_eta", 1), parameters["lm"], parameters["mm"]))
+    else:
+        print("%s, no MPI: one process of %d threads" % (grid, parameters.get("npp", 1)))
+    if samples:
+        print("Calibration: x%.2f from %d measured run(s)" % (factor, samples))
+    else:
+        print("Calibration: none yet (no measured runs), using the uncalibrated model")
+    print("Per rank: %.0f MB" % rank_mb)
+    print("Per node: %.1f GB (%d ranks per node, %.0f GB usable of %.0f GB)" % (
+        node_mb / 1024, ranks_per_node, usable_mb / 1024, args.node_memory_gb))
+
+    fitting_ranks = int(usable_mb // rank_mb)
+    if fitting_ranks < 1 and not mpi:
+        print("Warning: the run needs more than the usable memory of a node, and a build without MPI runs on one node.")
+        return 2
+    if fitting_ranks < 1:
+        print("Warning: one rank needs more than the usable memory of a node. Use more cores (a finer decomposition).")
+        return 2
+    nodes = math.ceil(ranks / min(fitting_ranks, args.tasks_per_node))
+    if node_mb > usable_mb:
+        print("Warning: %d ranks per node would exceed the node memory." % ranks_per_node)
+        print("Smallest node count that fits: %d (%d ranks per node)" % (nodes, math.ceil(ranks / nodes)))
+        return 2
+    print("Smallest node count that fits: %d" % nodes)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,316 @@
+/*
+ * MPI communication profile of a CROCO run (see mpi_profile)
+ *
+ * Preloaded into the model (LD_PRELOAD), this library interposes the Fortran MPI
+ * bindings CROCO calls (mpi_isend_, mpi_waitall_, ...) and forwards them to their
+ * PMPI versions. Open MPI's Fortran bindings call the PMPI C functions directly, so
+ * wrapping the C MPI_* functions would miss them. Per rank it counts
+ *
+ *   - messages and bytes sent and received, per peer rank
+ *   - the time spent in MPI, in waits for point-to-point messages (wait, waitall,
+ *     waitany, recv, sendrecv: the time a rank waits on its neighbours) and in
+ *     collectives (barrier, allreduce, reduce, bcast, gather, allgather)
+ *
+ * At MPI_Finalize the counters of all ranks are gathered on rank 0, which writes
+ *
+ *   $MPI_PROFILE_DIR/mpi_profile.tsv   one row per rank
+ *   $MPI_PROFILE_DIR/mpi_peers.tsv     messages and bytes per sending/receiving rank pair
+ *
+ * (MPI_PROFILE_DIR defaults to outputs). Build: mpicc -shared -fPIC -O2 -o libmpiprof.so
+ * mpi_profile.c; the pmpi_*_ symbols are resolved from the model's own MPI libraries.
+ */
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+    STAT_WALL,
+    STAT_MPI,
+    STAT_WAIT,
+    STAT_COLLECTIVE,
+    STAT_MSGS_SENT,
+    STAT_BYTES_SENT,
+    STAT_MSGS_RECV,
+    STAT_BYTES_RECV,
+    STAT_COLLECTIVE_CALLS,
+    STAT_COUNT
+};
+
+static const char *stat_names[STAT_COUNT] = {
+    "wall_s", "mpi_s", "wait_s", "collective_s",
+    "msgs_sent", "bytes_sent", "msgs_recv", "bytes_recv", "collective_calls"
+};
+
+static double stats[STAT_COUNT];
+static double start_time;
+static int world_rank = -1, world_size = 0;
+static double *peer_msgs = NULL, *peer_bytes = NULL;
+
+/* Fortran bindings of the MPI library (all arguments by reference) */
+typedef MPI_Fint fint;
+extern void pmpi_init_(fint *ierr);
+extern void pmpi_init_thread_(fint *required, fint *provided, fint *ierr);
+extern void pmpi_finalize_(fint *ierr);
+extern void pmpi_send_(void *buf, fint *count, fint *type, fint *dest, fint *tag, fint *comm, fint *ierr);
+extern void pmpi_isend_(void *buf, fint *count, fint *type, fint *dest, fint *tag, fint *comm,
+                        fint *request, fint *ierr);
+extern void pmpi_recv_(void *buf, fint *count, fint *type, fint *source, fint *tag, fint *comm,
+                       fint *status, fint *ierr);
+extern void pmpi_irecv_(void *buf, fint *count, fint *type, fint *source, fint *tag, fint *comm,
+                        fint *request, fint *ierr);
+extern void pmpi_sendrecv_(void *sendbuf, fint *sendcount, fint *sendtype, fint *dest, fint *sendtag,
+                           void *recvbuf, fint *recvcount, fint *recvtype, fint *source, fint *recvtag,
+                           fint *comm, fint *status, fint *ierr);
+extern void pmpi_wait_(fint *request, fint *status, fint *ierr);
+extern void pmpi_waitall_(fint *count, fint *requests, fint *statuses, fint *ierr);
+extern void pmpi_waitany_(fint *count, fint *requests, fint *index, fint *status, fint *ierr);
+extern void pmpi_barrier_(fint *comm, fint *ierr);
+extern void pmpi_allreduce_(void *sendbuf, void *recvbuf, fint *count, fint *type, fint *op, fint *comm,
+                            fint *ierr);
+extern void pmpi_reduce_(void *sendbuf, void *recvbuf, fint *count, fint *type, fint *op, fint *root,
+                         fint *comm, fint *ierr);
+extern void pmpi_bcast_(void *buf, fint *count, fint *type, fint *root, fint *comm, fint *ierr);
+extern void pmpi_allgather_(void *sendbuf, fint *sendcount, fint *sendtype, void *recvbuf, fint *recvcount,
+                            fint *recvtype, fint *comm, fint *ierr);
+extern void pmpi_gather_(void *sendbuf, fint *sendcount, fint *sendtype, void *recvbuf, fint *recvcount,
+                         fint *recvtype, fint *root, fint *comm, fint *ierr);
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double message_bytes(fint *count, fint *type)
+{
+    int size = 0;
+    PMPI_Type_size(MPI_Type_f2c(*type), &size);
+    return (double)*count * size;
+}
+
+/* Rank in MPI_COMM_WORLD of a rank of a communicator, -1 for MPI_PROC_NULL and wildcards */
+static int world_peer(fint *comm, int rank)
+{
+    MPI_Comm c_comm = MPI_Comm_f2c(*comm);
+    MPI_Group group, world_group;
+    int peer = -1;
+    if (rank < 0)
+        return -1;
+    if (c_comm == MPI_COMM_WORLD)
+        return rank;
+    PMPI_Comm_group(c_comm, &group);
+    PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+    PMPI_Group_translate_ranks(group, 1, &rank, world_group, &peer);
+    PMPI_Group_free(&group);
+    PMPI_Group_free(&world_group);
+    return peer == MPI_UNDEFINED ? -1 : peer;
+}
+
+static void count_send(fint *count, fint *type, fint *dest, fint *comm)
+{
+    double bytes = message_bytes(count, type);
+    int peer = world_peer(comm, *dest);
+    stats[STAT_MSGS_SENT] += 1;
+    stats[STAT_BYTES_SENT] += bytes;
+    if (peer >= 0 && peer < world_size) {
+        peer_msgs[peer] += 1;
+        peer_bytes[peer] += bytes;
+    }
+}
+
+static void count_recv(fint *count, fint *type)
+{
+    stats[STAT_MSGS_RECV] += 1;
+    stats[STAT_BYTES_RECV] += message_bytes(count, type);
+}
+
+static void start_profile(void)
+{
+    PMPI_Comm_rank(MPI_COMM_WORLD, &world_rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &world_size);
+    peer_msgs = calloc(world_size, sizeof(double));
+    peer_bytes = calloc(world_size, sizeof(double));
+    start_time = now();
+}
+
+static FILE *open_output(const char *name)
+{
+    const char *dir = getenv("MPI_PROFILE_DIR");
+    char path[4096];
+    FILE *file;
+    snprintf(path, sizeof(path), "%s/%s", dir && *dir ? dir : "outputs", name);
+    if (!(file = fopen(path, "w")))
+        fprintf(stderr, "mpi_profile: cannot write %s\n", path);
+    return file;
+}
+
+static void write_profile(void)
+{
+    double *all_stats = NULL, *all_msgs = NULL, *all_bytes = NULL;
+    FILE *file;
+    int rank, peer, i;
+
+    stats[STAT_WALL] = now() - start_time;
+    if (world_rank == 0) {
+        all_stats = malloc(sizeof(double) * STAT_COUNT * world_size);
+        all_msgs = malloc(sizeof(double) * world_size * world_size);
+        all_bytes = malloc(sizeof(double) * world_size * world_size);
+    }
+    PMPI_Gather(stats, STAT_COUNT, MPI_DOUBLE, all_stats, STAT_COUNT, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    PMPI_Gather(peer_msgs, world_size, MPI_DOUBLE, all_msgs, world_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    PMPI_Gather(peer_bytes, world_size, MPI_DOUBLE, all_bytes, world_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (world_rank != 0)
+        return;
+
+    if ((file = open_output("mpi_profile.tsv"))) {
+        fprintf(file, "# rank");
+        for (i = 0; i < STAT_COUNT; i++)
+            fprintf(file, "\t%s", stat_names[i]);
+        fprintf(file, "\n");
+        for (rank = 0; rank < world_size; rank++) {
+            fprintf(file, "%d", rank);
+            for (i = 0; i < STAT_COUNT; i++)
+                fprintf(file, i < STAT_MSGS_SENT ? "\t%.6f" : "\t%.0f", all_stats[rank * STAT_COUNT + i]);
+            fprintf(file, "\n");
+        }
+        fclose(file);
+    }
+    if ((file = open_output("mpi_peers.tsv"))) {
+        fprintf(file, "# source\tdest\tmsgs\tbytes\n");
+        for (rank = 0; rank < world_size; rank++)
+            for (peer = 0; peer < world_size; peer++)
+                if (all_msgs[rank * world_size + peer] > 0)
+                    fprintf(file, "%d\t%d\t%.0f\t%.0f\n", rank, peer, all_msgs[rank * world_size + peer],
+                            all_bytes[rank * world_size + peer]);
+        fclose(file);
+    }
+    free(all_stats);
+    free(all_msgs);
+    free(all_bytes);
+}
+
+/* Time a call in the MPI total and in one category (or none) */
+#define TIMED(category, call)                           \
+    do {                                                \
+        double t0_ = now(), dt_;                        \
+        call;                                           \
+        dt_ = now() - t0_;                              \
+        stats[STAT_MPI] += dt_;                         \
+        if ((category) >= 0)                            \
+            stats[(category)] += dt_;                   \
+    } while (0)
+
+void mpi_init_(fint *ierr)
+{
+    pmpi_init_(ierr);
+    start_profile();
+}
+
+void mpi_init_thread_(fint *required, fint *provided, fint *ierr)
+{
+    pmpi_init_thread_(required, provided, ierr);
+    start_profile();
+}
+
+void mpi_finalize_(fint *ierr)
+{
+    if (world_rank >= 0)
+        write_profile();
+    pmpi_finalize_(ierr);
+}
+
+void mpi_send_(void *buf, fint *count, fint *type, fint *dest, fint *tag, fint *comm, fint *ierr)
+{
+    count_send(count, type, dest, comm);
+    TIMED(-1, pmpi_send_(buf, count, type, dest, tag, comm, ierr));
+}
+
+void mpi_isend_(void *buf, fint *count, fint *type, fint *dest, fint *tag, fint *comm, fint *request,
+                fint *ierr)
+{
+    count_send(count, type, dest, comm);
+    TIMED(-1, pmpi_isend_(buf, count, type, dest, tag, comm, request, ierr));
+}
+
+void mpi_recv_(void *buf, fint *count, fint *type, fint *source, fint *tag, fint *comm, fint *status,
+               fint *ierr)
+{
+    count_recv(count, type);
+    TIMED(STAT_WAIT, pmpi_recv_(buf, count, type, source, tag, comm, status, ierr));
+}
+
+void mpi_irecv_(void *buf, fint *count, fint *type, fint *source, fint *tag, fint *comm, fint *request,
+                fint *ierr)
+{
+    count_recv(count, type);
+    TIMED(-1, pmpi_irecv_(buf, count, type, source, tag, comm, request, ierr));
+}
+
+void mpi_sendrecv_(void *sendbuf, fint *sendcount, fint *sendtype, fint *dest, fint *sendtag, void *recvbuf,
+                   fint *recvcount, fint *recvtype, fint *source, fint *recvtag, fint *comm, fint *status,
+                   fint *ierr)
+{
+    count_send(sendcount, sendtype, dest, comm);
+    count_recv(recvcount, recvtype);
+    TIMED(STAT_WAIT, pmpi_sendrecv_(sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount,
+                                    recvtype, source, recvtag, comm, status, ierr));
+}
+
+void mpi_wait_(fint *request, fint *status, fint *ierr)
+{
+    TIMED(STAT_WAIT, pmpi_wait_(request, status, ierr));
+}
+
+void mpi_waitall_(fint *count, fint *requests, fint *statuses, fint *ierr)
+{
+    TIMED(STAT_WAIT, pmpi_waitall_(count, requests, statuses, ierr));
+}
+
+void mpi_waitany_(fint *count, fint *requests, fint *index, fint *status, fint *ierr)
+{
+    TIMED(STAT_WAIT, pmpi_waitany_(count, requests, index, status, ierr));
+}
+
+void mpi_barrier_(fint *comm, fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_barrier_(comm, ierr));
+}
+
+void mpi_allreduce_(void *sendbuf, void *recvbuf, fint *count, fint *type, fint *op, fint *comm, fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_allreduce_(sendbuf, recvbuf, count, type, op, comm, ierr));
+}
+
+void mpi_reduce_(void *sendbuf, void *recvbuf, fint *count, fint *type, fint *op, fint *root, fint *comm,
+                 fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_reduce_(sendbuf, recvbuf, count, type, op, root, comm, ierr));
+}
+
+void mpi_bcast_(void *buf, fint *count, fint *type, fint *root, fint *comm, fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_bcast_(buf, count, type, root, comm, ierr));
+}
+
+void mpi_allgather_(void *sendbuf, fint *sendcount, fint *sendtype, void *recvbuf, fint *recvcount,
+                    fint *recvtype, fint *comm, fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_allgather_(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm,
+                                           ierr));
+}
+
+void mpi_gather_(void *sendbuf, fint *sendcount, fint *sendtype, void *recvbuf, fint *recvcount,
+                 fint *recvtype, fint *root, fint *comm, fint *ierr)
+{
+    stats[STAT_COLLECTIVE_CALLS] += 1;
+    TIMED(STAT_COLLECTIVE, pmpi_gather_(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root,
+                                        comm, ierr));
+}
@@ -0,0 +1,178 @@
+import argparse
+import os
+import sys
+from collections import defaultdict
+
+# Load-imbalance report of an MPI profile (mpi_profile.c) on the tile grid of the run.
+#
+# CROCO numbers its ranks row by row over the NP_XI x NP_ETA tiles (MPI_Setup: i = rank
+# mod NP_XI, j = rank / NP_XI), so every rank is one tile. The compute time of a tile is
+# its wall time outside MPI. The imbalance is the slowest tile's compute time over the
+# mean: with 1.25 the other tiles spend on average a fifth of the slowest one's time
+# waiting for it in the halo exchanges and collectives.
+
+CELL_MAX = 48
+PANEL_SIZE = 360
+MARGIN = 30
+FONT_SIZE = 11
+PANELS = (
+    ('compute_s', 'compute time (s)'),
+    ('wait_pct', 'waiting on neighbours (% of wall)'),
+    ('mpi_pct', 'time in MPI (% of wall)'),
+)
+
+
+def read_profile(profile_file):
+    """Rows of mpi_profile.tsv as {rank: {column: value}}"""
+    ranks = {}
+    with open(profile_file) as f:
+        columns = None
+        for line in f:
+            fields = line.rstrip('\n').split('\t')
+            if line.startswith('#'):
+                columns = [fields[0].lstrip('# ')] + fields[1:]
+                continue
+            if columns and len(fields) == len(columns):
+                row = dict(zip(columns, map(float, fields)))
+                ranks[int(row['rank'])] = row
+    return ranks
+
+
+def read_peers(peers_file):
+    """Number of ranks each rank sends to"""
+    peers = defaultdict(int)
+    if os.path.isfile(peers_file):
+        with open(peers_file) as f:
+            for line in f:
+                if line.startswith('#') or not line.strip():
+                    continue
+                source = int(line.split('\t')[0])
+                peers[source] += 1
+    return peers
+
+
+def tile_rows(ranks, peers, np_xi):
+    rows = []
+    for rank, row in sorted(ranks.items()):
+        wall = max(row['wall_s'], 1e-9)
+        rows.append({
+            'rank': rank, 'i': rank % np_xi, 'j': rank // np_xi,
+            'compute_s': max(row['wall_s'] - row['mpi_s'], 0.0),
+            'mpi_s': row['mpi_s'], 'wait_s': row['wait_s'], 'collective_s': row['collective_s'],
+            'mpi_pct': 100.0 * row['mpi_s'] / wall, 'wait_pct': 100.0 * row['wait_s'] / wall,
+            'msgs_sent': int(row['msgs_sent']), 'bytes_sent': int(row['bytes_sent']),
+            'neighbours': peers.get(rank, 0),
+        })
+    return rows
+
+
+def summary(rows):
+    computes = [row['compute_s'] for row in rows]
+    mean_compute = sum(computes) / len(computes)
+    slowest = max(rows, key=lambda row: row['compute_s'])
+    wall = sum(row['compute_s'] + row['mpi_s'] for row in rows)
+    return {
+        'ranks': len(rows),
+        'imbalance': round(slowest['compute_s'] / mean_compute, 3) if mean_compute > 0 else 1.0,
+        'slowest_rank': slowest['rank'],
+        'slowest_i': slowest['i'],
+        'slowest_j': slowest['j'],
+        'mpi_pct': round(100.0 * sum(row['mpi_s'] for row in rows) / wall, 2) if wall > 0 else 0.0,
+        'mean_wait_pct': round(sum(row['wait_pct'] for row in rows) / len(rows), 2),
+        'max_wait_pct': round(max(row['wait_pct'] for row in rows), 2),
+        'bytes_sent': sum(row['bytes_sent'] for row in rows),
+    }
+
+
+def color(fraction):
+    """White for 0 to dark red for 1"""
+    fraction = min(max(fraction, 0.0), 1.0)
+    return f'rgb({255 - int(75 * fraction)},{255 - int(235 * fraction)},{255 - int(235 * fraction)})'
+
+
+def heatmap(rows, np_xi, np_eta, title):
+    """SVG with one tile grid per panel, north up, colour scaled to the panel maximum"""
+    cell = max(min(CELL_MAX, PANEL_SIZE // max(np_xi, np_eta)), 2)
+    panel_width, panel_height = cell * np_xi, cell * np_eta
+    width = len(PANELS) * (panel_width + MARGIN) + MARGIN
+    height = panel_height + 3 * MARGIN
+    parts = [
+        f'<svg xmlns="http://www.w3.org/2000/svg" width="{width}" height="{height}" '
+        f'font-family="monospace" font-size="{FONT_SIZE}">',
+        '<rect width="100%" height="100%" fill="#fafafa"/>',
+        f'<text x="{width / 2}" y="{FONT_SIZE + 4}" text-anchor="middle" font-size="{FONT_SIZE + 3}">'
+        f'{title}, {np_xi}x{np_eta} tiles</text>',
+    ]
+    for index, (key, label) in enumerate(PANELS):
+        x0 = MARGIN + index * (panel_width + MARGIN)
+        y0 = 2 * MARGIN
+        top = max(row[key] for row in rows) or 1.0
+        parts.append(f'<text x="{x0}" y="{y0 - 6}">{label}, max {top:.3g}</text>')
+        for row in rows:
+            x = x0 + row['i'] * cell
+            y = y0 + (np_eta - 1 - row['j']) * cell
+            parts.append(f'<g><title>rank {row["rank"]} (i={row["i"]}, j={row["j"]}): {row[key]:.3f}</title>'
+                         f'<rect x="{x}" y="{y}" width="{cell}" height="{cell}" fill="{color(row[key] / top)}" '
+                         f'stroke="#999" stroke-width="{0.5 if cell > 4 else 0}"/></g>')
+            if cell >= 4 * FONT_SIZE:
+                parts.append(f'<text x="{x + cell / 2}" y="{y + cell / 2 + 4}" text-anchor="middle">'
+                             f'{row[key]:.3g}</text>')
+    parts.append('</svg>')
+    return '\n'.join(parts) + '\n'
+
+
+def print_grid(rows, np_xi, np_eta):
+    """Compute time of every tile relative to the mean, north up"""
+    mean = sum(row['compute_s'] for row in rows) / len(rows) or 1.0
+    grid = {(row['i'], row['j']): row['compute_s'] / mean for row in rows}
+    print('Compute time per tile relative to the mean (north up):')
+    for j in reversed(range(np_eta)):
+        print(f'  j={j:<3}' + ''.join(f'{grid[(i, j)]:6.2f}' for i in range(np_xi)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Load-imbalance report of an MPI profile.')
+    parser.add_argument('profile', help='mpi_profile.tsv of the run')
+    parser.add_argument('--peers', default='', help='mpi_peers.tsv of the run')
+    parser.add_argument('--np-xi', type=int, required=True)
+    parser.add_argument('--np-eta', type=int, required=True)
+    parser.add_argument('--out-dir', required=True, help='Directory of the report')
+    parser.add_argument('--title', default='CROCO', help='Title of the heatmap')
+    args = parser.parse_args()
+
+    ranks = read_profile(args.profile)
+    if not ranks:
+        print(f'Error: no ranks in {args.profile}.', file=sys.stderr)
+        return 1
+    if len(ranks) != args.np_xi * args.np_eta:
+        print(f'Error: {len(ranks)} ranks in the profile, but the test is decomposed in '
+              f'{args.np_xi}x{args.np_eta} tiles.', file=sys.stderr)
+        return 1
+
+    rows = tile_rows(ranks, read_peers(args.peers), args.np_xi)
+    values = summary(rows)
+    os.makedirs(args.out_dir, exist_ok=True)
+    columns = ['rank', 'i', 'j', 'compute_s', 'mpi_s', 'wait_s', 'collective_s', 'wait_pct', 'mpi_pct',
+               'msgs_sent', 'bytes_sent', 'neighbours']
+    with open(os.path.join(args.out_dir, 'mpi_tiles.tsv'), 'w') as f:
+        f.write('# ' + '\t'.join(columns) + '\n')
+        for row in rows:
+            f.write('\t'.join(f'{row[c]:.6f}' if isinstance(row[c], float) else str(row[c]) for c in columns)
+                    + '\n')
+    with open(os.path.join(args.out_dir, 'mpi_heatmap.svg'), 'w') as f:
+        f.write(heatmap(rows, args.np_xi, args.np_eta, args.title))
+    with open(os.path.join(args.out_dir, 'mpi_summary.tsv'), 'w') as f:
+        for key, value in values.items():
+            f.write(f'{key}\t{value}\n')
+
+    print_grid(rows, args.np_xi, args.np_eta)
+    print(f'Imbalance (slowest/mean compute time): {values["imbalance"]:.3f}, slowest tile '
+          f'i={values["slowest_i"]} j={values["slowest_j"]} (rank {values["slowest_rank"]})')
+    print(f'Time in MPI: {values["mpi_pct"]:.1f}%, waiting on neighbours: {values["mean_wait_pct"]:.1f}% '
+          f'on average, {values["max_wait_pct"]:.1f}% at most')
+    print(f'Tile table and heatmap written to {args.out_dir}.')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
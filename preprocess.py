@@ -1,13 +1,25 @@
 import sys
 from utils.preprocessing_utils import load_and_preprocess
+import preprocess_cache
 
-# sys.argv[0] is the script name, get the two arguments
-if len(sys.argv) == 2:
-    path = sys.argv[1]
+# sys.argv[0] is the script name, get the arguments
+args = sys.argv[1:]
+force = "-f" in args
+if force:
+    args.remove("-f")
+
+if len(args) == 1:
+    path = args[0]
 else:
-    print("Usage: python preprocess.py <path>")
+    print("Usage: python preprocess.py [-f] <path>")
     sys.exit(1)
 
+# Reuse the preprocessed file only if it was built from this exact history file and preprocessing code
+if not force and preprocess_cache.is_current(path):
+    print("History file has already been preprocessed.")
+    sys.exit(0)
+
 # Load and preprocess the data
+preprocess_cache.invalidate(path)
 load_and_preprocess(path)
-
+preprocess_cache.record(path)
@@ -1,20 +1,157 @@
 import sys
 import os
+import time
+import inspect
+import argparse
+import resource
+import multiprocessing
 from utils.preprocessing_utils import load_and_preprocess
+import preprocess_cache
 
-# sys.argv[0] is the script name, get the two arguments
-paths = []
-if len(sys.argv) > 1:
-    paths = sys.argv[1:]
-else:
-    print("Please provide at least one path to the data")
-    sys.exit(1)
-    
-#check if all paths are valid
-for path in paths:
-    if not os.path.exists(path):
-        print("The path {} does not exist".format(path))
+
+def parse_arguments():
+    parser = argparse.ArgumentParser(description="Preprocess CROCO history files, optionally in parallel.")
+    parser.add_argument("paths", nargs="+", help="output_his.nc files to preprocess")
+    parser.add_argument("-j", "--jobs", type=int, default=1,
+                        help="number of worker processes (0 = as many as memory and cores allow)")
+    parser.add_argument("-m", "--memory-per-worker", type=float, default=0,
+                        help="memory budget per worker in GB (0 = no limit)")
+    parser.add_argument("-c", "--chunk-size", type=int, default=0,
+                        help="number of time records loaded at once (0 = load the whole file)")
+    parser.add_argument("-f", "--force", action="store_true",
+                        help="preprocess even if the cached result is current")
+    return parser.parse_args()
+
+
+def available_memory_gb():
+    # MemAvailable is the kernel's estimate of what can be allocated without swapping
+    try:
+        with open("/proc/meminfo") as meminfo:
+            for line in meminfo:
+                if line.startswith("MemAvailable:"):
+                    return int(line.split()[1]) / 1024 ** 2
+    except OSError:
+        pass
+    return None
+
+
+def choose_worker_count(requested, n_files, memory_per_worker):
+    workers = requested if requested > 0 else os.cpu_count() or 1
+    workers = min(workers, n_files)
+
+    # Never start more workers than the node can hold at their full budget
+    if memory_per_worker > 0:
+        available = available_memory_gb()
+        if available is not None:
+            fit = max(1, int(available // memory_per_worker))
+            if fit < workers:
+                print("Only {:.1f} GB available: limiting to {} worker(s) of {:.1f} GB".format(
+                    available, fit, memory_per_worker))
+                workers = fit
+    return max(1, workers)
+
+
+def init_worker(memory_per_worker, chunk_size):
+    # RLIMIT_DATA covers heap and anonymous mappings, so a file that would not fit
+    # raises MemoryError in its own worker instead of pushing the node into the OOM killer
+    if memory_per_worker > 0:
+        limit = int(memory_per_worker * 1024 ** 3)
+        resource.setrlimit(resource.RLIMIT_DATA, (limit, limit))
+
+    # Each worker is already one process per file, so keep dask single-threaded
+    # to stay within the budget when chunked loading is used
+    if chunk_size > 0:
+        try:
+            import dask
+            dask.config.set(scheduler="synchronous")
+        except ImportError:
+            pass
+
+
+def supports_chunks():
+    try:
+        return "chunks" in inspect.signature(load_and_preprocess).parameters
+    except (TypeError, ValueError):
+        return False
+
+
+def preprocess_one(task):
+    path, chunk_size = task
+    size = os.path.getsize(path)
+    start = time.monotonic()
+    try:
+        preprocess_cache.invalidate(path)
+        if chunk_size > 0 and supports_chunks():
+            load_and_preprocess(path, chunks={"time": chunk_size})
+        else:
+            load_and_preprocess(path)
+        preprocess_cache.record(path)
+        error = None
+    except MemoryError:
+        error = "exceeded the per-worker memory budget"
+    except Exception as exc:
+        error = "{}: {}".format(type(exc).__name__, exc)
+    return path, size, time.monotonic() - start, error
+
+
+def main():
+    args = parse_arguments()
+    paths = args.paths
+
+    #check if all paths are valid
+    for path in paths:
+        if not os.path.exists(path):
+            print("The path {} does not exist".format(path))
+            sys.exit(1)
+
+    # Skip files whose preprocessed result matches the history content and preprocessing code
+    if not args.force:
+        stale = [path for path in paths if not preprocess_cache.is_current(path)]
+        if len(stale) < len(paths):
+            print("{} file(s) already preprocessed and up to date".format(len(paths) - len(stale)))
+        paths = stale
+    if not paths:
+        print("No tests to preprocess.")
+        return
+
+    if args.chunk_size > 0 and not supports_chunks():
+        print("Warning: load_and_preprocess does not accept chunks, files will be loaded whole")
+
+    workers = choose_worker_count(args.jobs, len(paths), args.memory_per_worker)
+    print("Preprocessing {} file(s) with {} worker(s)".format(len(paths), workers))
+
+    # Largest files first so a hires file does not end up alone at the tail of the queue
+    tasks = [(path, args.chunk_size) for path in sorted(paths, key=os.path.getsize, reverse=True)]
+
+    failures = []
+    total_bytes = 0
+    start = time.monotonic()
+
+    # One task per child: memory held by a large file is returned to the OS before the next one
+    with multiprocessing.Pool(workers, initializer=init_worker,
+                              initargs=(args.memory_per_worker, args.chunk_size),
+                              maxtasksperchild=1) as pool:
+        for done, (path, size, elapsed, error) in enumerate(pool.imap_unordered(preprocess_one, tasks), 1):
+            size_mb = size / 1024 ** 2
+            if error is None:
+                total_bytes += size
+                print("[{}/{}] {}: {:.1f} MB in {:.1f} s ({:.1f} MB/s)".format(
+                    done, len(tasks), path, size_mb, elapsed, size_mb / max(elapsed, 1e-6)))
+            else:
+                failures.append(path)
+                print("[{}/{}] {}: failed after {:.1f} s ({})".format(done, len(tasks), path, elapsed, error))
+            sys.stdout.flush()
+
+    elapsed = time.monotonic() - start
+    print("Processed {:.1f} MB in {:.1f} s ({:.1f} MB/s overall)".format(
+        total_bytes / 1024 ** 2, elapsed, total_bytes / 1024 ** 2 / max(elapsed, 1e-6)))
+
+    if failures:
+        print("{} file(s) failed:".format(len(failures)))
+        for path in failures:
+            print("  {}".format(path))
         sys.exit(1)
 
-for path in paths:
-    load_and_preprocess(path)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,105 @@
+import os
+import sys
+import hashlib
+import inspect
+import utils.preprocessing_utils as preprocessing_utils
+
+# Cache key written next to output_his_preprocessed.nc. The size and mtime lines are
+# plain key=value so shell scripts (ttree) can do the cheap part of the check themselves.
+KEY_SUFFIX = "_preprocessed.key"
+PREPROCESSED_SUFFIX = "_preprocessed.nc"
+
+HEADER_BYTES = 1024 * 1024
+SAMPLE_BYTES = 64 * 1024
+SAMPLE_COUNT = 16
+
+
+def preprocessed_path(history_path):
+    return history_path[:-len(".nc")] + PREPROCESSED_SUFFIX
+
+
+def key_path(history_path):
+    return history_path[:-len(".nc")] + KEY_SUFFIX
+
+
+def content_hash(history_path, size):
+    # The netCDF header (dimensions, attributes, record count) plus evenly spaced blocks
+    # across the record section and the tail, which holds the last written records
+    digest = hashlib.sha256()
+    with open(history_path, "rb") as f:
+        digest.update(f.read(HEADER_BYTES))
+        if size > HEADER_BYTES:
+            step = (size - HEADER_BYTES) // SAMPLE_COUNT
+            for i in range(1, SAMPLE_COUNT + 1):
+                f.seek(min(HEADER_BYTES + i * step, size) - SAMPLE_BYTES)
+                digest.update(f.read(SAMPLE_BYTES))
+    return digest.hexdigest()
+
+
+def utils_version():
+    # Any edit to the preprocessing code changes the key, so results are rebuilt
+    digest = hashlib.sha256()
+    digest.update(str(getattr(preprocessing_utils, "__version__", "")).encode())
+    source = inspect.getsourcefile(preprocessing_utils)
+    if source is not None:
+        with open(source, "rb") as f:
+            digest.update(f.read())
+    return digest.hexdigest()
+
+
+def compute_key(history_path):
+    st = os.stat(history_path)
+    return {
+        "size": str(st.st_size),
+        "mtime": str(int(st.st_mtime)),
+        "content": content_hash(history_path, st.st_size),
+        "utils": utils_version(),
+    }
+
+
+def read_key(history_path):
+    key = {}
+    try:
+        with open(key_path(history_path)) as f:
+            for line in f:
+                name, _, value = line.strip().partition("=")
+                if name:
+                    key[name] = value
+    except OSError:
+        pass
+    return key
+
+
+def is_current(history_path):
+    if not os.path.exists(preprocessed_path(history_path)):
+        return False
+    stored = read_key(history_path)
+    if not stored:
+        return False
+    # Compare the cheap fields first so unchanged files are never hashed twice
+    st = os.stat(history_path)
+    if stored.get("size") != str(st.st_size) or stored.get("mtime") != str(int(st.st_mtime)):
+        return False
+    return stored == compute_key(history_path)
+
+
+def invalidate(history_path):
+    for path in (preprocessed_path(history_path), key_path(history_path)):
+        if os.path.exists(path):
+            os.remove(path)
+
+
+def record(history_path):
+    key = compute_key(history_path)
+    tmp_path = key_path(history_path) + ".tmp"
+    with open(tmp_path, "w") as f:
+        for name in ("size", "mtime", "content", "utils"):
+            f.write("{}={}\n".format(name, key[name]))
+    os.replace(tmp_path, key_path(history_path))
+
+
+if __name__ == "__main__":
+    # Usage: python preprocess_cache.py <path>...  -> prints the paths that need preprocessing
+    for path in sys.argv[1:]:
+        if not is_current(path):
+            print(path)
@@ -0,0 +1,181 @@
+import argparse
+import hashlib
+import os
+import re
+import subprocess
+import sys
+from collections import defaultdict
+
+# Merge the perf call stacks of the profiled ranks of a run (profile_test) into folded
+# stacks, a flame graph and a per-routine table.
+#
+# Each perf.<rank>.data is read with `perf script -F ip,sym`, which prints one frame per
+# line (leaf first) and a blank line after every sample. Stacks are folded root first,
+# like the stackcollapse scripts of the FlameGraph tools, so the .folded file can also be
+# fed to those. The flame graph is drawn here to avoid the dependency.
+
+FRAME = re.compile(r'^\s*[0-9a-fA-F]+\s+(.+?)(?:\+0x[0-9a-fA-F]+)?(?:\s+\(.*\))?\s*$')
+SVG_WIDTH = 1200
+FRAME_HEIGHT = 16
+FONT_SIZE = 11
+MIN_LABEL_WIDTH = 30
+
+
+def read_stacks(data_file):
+    """Folded stacks of one perf data file: {"root;...;leaf": samples}"""
+    result = subprocess.run(['perf', 'script', '-F', 'ip,sym', '-i', data_file],
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f'perf script failed on {data_file}')
+    stacks = defaultdict(int)
+    frames = []
+    for line in result.stdout.splitlines() + ['']:
+        if not line.strip():
+            if frames:
+                stacks[';'.join(reversed(frames))] += 1
+                frames = []
+            continue
+        match = FRAME.match(line)
+        if match:
+            frames.append(match.group(1).replace(';', ':'))
+    return stacks
+
+
+def routine_table(stacks_by_rank):
+    """Rows of routine, self and total samples, and the spread of the self share over ranks"""
+    total_samples = 0
+    self_samples = defaultdict(int)
+    total = defaultdict(int)
+    self_share = defaultdict(dict)
+    for rank, stacks in stacks_by_rank.items():
+        rank_samples = sum(stacks.values())
+        rank_self = defaultdict(int)
+        for stack, count in stacks.items():
+            frames = stack.split(';')
+            rank_self[frames[-1]] += count
+            for routine in set(frames):
+                total[routine] += count
+        for routine, count in rank_self.items():
+            self_samples[routine] += count
+            self_share[routine][rank] = 100.0 * count / rank_samples
+        total_samples += rank_samples
+
+    rows = []
+    ranks = list(stacks_by_rank)
+    for routine in sorted(total, key=lambda r: (-self_samples[r], -total[r], r)):
+        shares = [self_share[routine].get(rank, 0.0) for rank in ranks]
+        rows.append((routine, self_samples[routine], 100.0 * self_samples[routine] / total_samples,
+                     total[routine], 100.0 * total[routine] / total_samples, min(shares), max(shares)))
+    return rows, total_samples
+
+
+def color(name):
+    """Warm flame graph colour, stable per routine"""
+    value = int(hashlib.md5(name.encode()).hexdigest()[:6], 16)
+    return f'rgb({205 + value % 50},{80 + (value >> 8) % 130},{(value >> 16) % 55})'
+
+
+def escape(text):
+    return text.replace('&', '&amp;').replace('<', '&lt;').replace('>', '&gt;').replace('"', '&quot;')
+
+
+def flame_graph(stacks, title):
+    """SVG flame graph: the root at the bottom, one row per stack depth, widths by samples"""
+    tree = {'children': {}, 'count': 0}
+    for stack, count in stacks.items():
+        node = tree
+        node['count'] += count
+        for frame in stack.split(';'):
+            node = node['children'].setdefault(frame, {'children': {}, 'count': 0})
+            node['count'] += count
+
+    def depth(node):
+        return 1 + max((depth(child) for child in node['children'].values()), default=0)
+
+    levels = depth(tree) - 1
+    height = (levels + 3) * FRAME_HEIGHT
+    scale = SVG_WIDTH / max(tree['count'], 1)
+    rects = []
+
+    def draw(node, x, level):
+        for name, child in sorted(node['children'].items()):
+            width = child['count'] * scale
+            if width >= 0.5:
+                y = height - (level + 2) * FRAME_HEIGHT
+                share = 100.0 * child['count'] / tree['count']
+                label = f'{escape(name)} ({child["count"]} samples, {share:.2f}%)'
+                rects.append(f'<g><title>{label}</title>'
+                             f'<rect x="{x:.2f}" y="{y}" width="{width:.2f}" height="{FRAME_HEIGHT - 1}" '
+                             f'fill="{color(name)}"/>')
+                if width >= MIN_LABEL_WIDTH:
+                    chars = int(width / (FONT_SIZE * 0.6))
+                    text = name if len(name) <= chars else name[:max(chars - 2, 1)] + '..'
+                    rects.append(f'<text x="{x + 3:.2f}" y="{y + FRAME_HEIGHT - 4}">{escape(text)}</text>')
+                rects.append('</g>')
+                draw(child, x, level + 1)
+            x += width
+
+    draw(tree, 0.0, 0)
+    return '\n'.join([
+        f'<svg xmlns="http://www.w3.org/2000/svg" width="{SVG_WIDTH}" height="{height}" '
+        f'font-family="monospace" font-size="{FONT_SIZE}">',
+        f'<rect width="100%" height="100%" fill="#fafafa"/>',
+        f'<text x="{SVG_WIDTH / 2}" y="{FRAME_HEIGHT}" text-anchor="middle" font-size="{FONT_SIZE + 3}">'
+        f'{escape(title)} ({tree["count"]} samples)</text>',
+        *rects,
+        '</svg>',
+    ]) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge perf profiles of the ranks of a run.')
+    parser.add_argument('data_files', nargs='+', help='perf.<rank>.data files')
+    parser.add_argument('--out-dir', required=True, help='Directory of the merged profile')
+    parser.add_argument('--title', default='CROCO', help='Title of the flame graph')
+    args = parser.parse_args()
+
+    stacks_by_rank = {}
+    for data_file in args.data_files:
+        if not os.path.isfile(data_file):
+            print(f'Error: no profile data ({data_file} not found).', file=sys.stderr)
+            return 1
+        match = re.search(r'perf\.(\d+)\.data$', data_file)
+        rank = int(match.group(1)) if match else len(stacks_by_rank)
+        try:
+            stacks_by_rank[rank] = read_stacks(data_file)
+        except RuntimeError as error:
+            print(f'Error: {error}', file=sys.stderr)
+            return 1
+    stacks_by_rank = {rank: stacks for rank, stacks in sorted(stacks_by_rank.items()) if stacks}
+    if not stacks_by_rank:
+        print('Error: the profiles hold no call stacks.', file=sys.stderr)
+        return 1
+
+    merged = defaultdict(int)
+    for stacks in stacks_by_rank.values():
+        for stack, count in stacks.items():
+            merged[stack] += count
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    with open(os.path.join(args.out_dir, 'profile.folded'), 'w') as f:
+        for stack, count in sorted(merged.items()):
+            f.write(f'{stack} {count}\n')
+    with open(os.path.join(args.out_dir, 'profile.svg'), 'w') as f:
+        f.write(flame_graph(merged, f'{args.title}, ranks {",".join(map(str, stacks_by_rank))}'))
+
+    rows, total_samples = routine_table(stacks_by_rank)
+    with open(os.path.join(args.out_dir, 'profile_routines.tsv'), 'w') as f:
+        f.write('# routine\tself_samples\tself_pct\ttotal_samples\ttotal_pct\tself_pct_min_rank\tself_pct_max_rank\n')
+        for routine, self_count, self_pct, total_count, total_pct, share_min, share_max in rows:
+            f.write(f'{routine}\t{self_count}\t{self_pct:.2f}\t{total_count}\t{total_pct:.2f}\t'
+                    f'{share_min:.2f}\t{share_max:.2f}\n')
+
+    print(f'{total_samples} samples from {len(stacks_by_rank)} rank(s). Hottest routines (self time):')
+    for routine, _, self_pct, _, total_pct, _, _ in rows[:10]:
+        print(f'  {self_pct:6.2f}%  {routine}  (total {total_pct:.2f}%)')
+    print(f'Flame graph and routine table written to {args.out_dir}.')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,99 @@
+/*
+ * Peak floating point throughput and memory bandwidth of a node (roofline)
+ *
+ * Run with OMP_NUM_THREADS set to the cores of the measured runs, bound like them
+ * (OMP_PLACES=cores OMP_PROC_BIND=close). Prints one line, "<gflops>\t<gbytes_per_s>":
+ *
+ *   gflops        FMA chains of FMA_CHAINS independent accumulators per thread, which
+ *                 the compiler vectorizes for the host (-O3 -march=native); 2 FLOPs per
+ *                 FMA and lane
+ *   gbytes_per_s  STREAM triad a = b + s*c over TRIAD_LENGTH doubles per array, counting
+ *                 24 bytes per element (no write allocate), as STREAM does
+ *
+ * Both are the best of REPEATS timings.
+ */
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FMA_CHAINS 64
+#define FMA_ITERATIONS 20000000L
+#define TRIAD_LENGTH (1L << 25)
+#define REPEATS 5
+
+static double fma_gflops(void)
+{
+    double best = 0.0, sink = 0.0;
+    int repeat;
+    for (repeat = 0; repeat < REPEATS; repeat++) {
+        double start = omp_get_wtime(), seconds;
+#pragma omp parallel reduction(+:sink)
+        {
+            double acc[FMA_CHAINS], x = 0.999999, y = 1e-7;
+            long iteration;
+            int j;
+            for (j = 0; j < FMA_CHAINS; j++)
+                acc[j] = (double) (j + omp_get_thread_num());
+            for (iteration = 0; iteration < FMA_ITERATIONS / FMA_CHAINS; iteration++)
+                for (j = 0; j < FMA_CHAINS; j++)
+                    acc[j] = acc[j] * x + y;
+            for (j = 0; j < FMA_CHAINS; j++)
+                sink += acc[j];
+        }
+        seconds = omp_get_wtime() - start;
+        if (seconds > 0) {
+            double gflops = 2.0 * (FMA_ITERATIONS / FMA_CHAINS) * FMA_CHAINS * omp_get_max_threads() / seconds / 1e9;
+            if (gflops > best)
+                best = gflops;
+        }
+    }
+    /* Keep the accumulators live */
+    if (sink == 42.0)
+        fprintf(stderr, "%f\n", sink);
+    return best;
+}
+
+static double triad_gbytes_per_s(void)
+{
+    double *a = malloc(TRIAD_LENGTH * sizeof(double));
+    double *b = malloc(TRIAD_LENGTH * sizeof(double));
+    double *c = malloc(TRIAD_LENGTH * sizeof(double));
+    double best = 0.0, scalar = 3.0;
+    long i;
+    int repeat;
+
+    if (!a || !b || !c) {
+        fprintf(stderr, "roofline_peak: out of memory\n");
+        exit(1);
+    }
+    /* First touch by the threads that use the pages */
+#pragma omp parallel for schedule(static)
+    for (i = 0; i < TRIAD_LENGTH; i++) {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = 2.0;
+    }
+    for (repeat = 0; repeat < REPEATS; repeat++) {
+        double start = omp_get_wtime(), seconds;
+#pragma omp parallel for schedule(static)
+        for (i = 0; i < TRIAD_LENGTH; i++)
+            a[i] = b[i] + scalar * c[i];
+        seconds = omp_get_wtime() - start;
+        if (seconds > 0 && 24.0 * TRIAD_LENGTH / seconds / 1e9 > best)
+            best = 24.0 * TRIAD_LENGTH / seconds / 1e9;
+    }
+    if (a[TRIAD_LENGTH / 2] != b[0] + scalar * c[0])
+        fprintf(stderr, "roofline_peak: triad check failed\n");
+    free(a);
+    free(b);
+    free(c);
+    return best;
+}
+
+int main(void)
+{
+    double gflops = fma_gflops();
+    double gbytes_per_s = triad_gbytes_per_s();
+    printf("%.2f\t%.2f\n", gflops, gbytes_per_s);
+    return 0;
+}
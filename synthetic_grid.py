@@ -0,0 +1,74 @@
+import argparse
+import os
+import sys
+
+import netCDF4
+import numpy as np
+
+# Synthetic inputs of a larger domain for weak-scaling benchmarks (benchmark_scaling -w).
+#
+# Every variable of the grid, forcing, restart (and boundary/climatology) files is
+# extended on its horizontal dimensions by mirroring the original domain, so the grid
+# spacing, bathymetry statistics, land fraction and forcing of the tiles stay those of
+# the resolution while the domain grows with the core count. Mirroring keeps the fields
+# continuous across the copies. Dimension sizes follow the CROCO conventions for an
+# LLm0 x MMm0 interior grid: xi_rho = LLm0+2, xi_u = LLm0+1, eta_rho = MMm0+2, ...
+
+def dimension_sizes(llm0, mmm0):
+    return {
+        'xi_rho': llm0 + 2, 'xi_u': llm0 + 1, 'xi_v': llm0 + 2, 'xi_psi': llm0 + 1,
+        'eta_rho': mmm0 + 2, 'eta_u': mmm0 + 2, 'eta_v': mmm0 + 1, 'eta_psi': mmm0 + 1,
+    }
+
+
+def mirror_indices(old_size, new_size):
+    """Indices 0..old-1, old-1..0, 0..old-1, ... up to new_size"""
+    positions = np.arange(new_size) % (2 * old_size)
+    return np.where(positions < old_size, positions, 2 * old_size - 1 - positions)
+
+
+def extend_file(source, destination, sizes):
+    with netCDF4.Dataset(source) as src, netCDF4.Dataset(destination, 'w', format=src.data_model) as dst:
+        dst.setncatts({name: src.getncattr(name) for name in src.ncattrs()})
+        for name, dimension in src.dimensions.items():
+            if dimension.isunlimited():
+                dst.createDimension(name, None)
+            else:
+                dst.createDimension(name, sizes.get(name, len(dimension)))
+        for name, variable in src.variables.items():
+            fill_value = variable.getncattr('_FillValue') if '_FillValue' in variable.ncattrs() else None
+            compress = (variable.filters() or {}).get('zlib', False)
+            out = dst.createVariable(name, variable.datatype, variable.dimensions, fill_value=fill_value,
+                                     zlib=compress)
+            out.setncatts({attr: variable.getncattr(attr) for attr in variable.ncattrs() if attr != '_FillValue'})
+            data = variable[...]
+            for axis, dimension in enumerate(variable.dimensions):
+                if dimension in sizes and data.shape[axis] != sizes[dimension]:
+                    data = np.take(data, mirror_indices(data.shape[axis], sizes[dimension]), axis=axis)
+            out[...] = data
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Extend CROCO input files to a larger synthetic domain.')
+    parser.add_argument('files', nargs='+', help='Input netCDF files')
+    parser.add_argument('--llm0', type=int, required=True, help='Interior points in xi of the new grid')
+    parser.add_argument('--mmm0', type=int, required=True, help='Interior points in eta of the new grid')
+    parser.add_argument('--out-dir', required=True, help='Directory of the extended files (same names)')
+    args = parser.parse_args()
+
+    sizes = dimension_sizes(args.llm0, args.mmm0)
+    os.makedirs(args.out_dir, exist_ok=True)
+    for source in args.files:
+        destination = os.path.join(args.out_dir, os.path.basename(source))
+        if os.path.realpath(source) == os.path.realpath(destination):
+            print(f'Error: {source} would be overwritten by its extension.', file=sys.stderr)
+            return 1
+        if os.path.lexists(destination):
+            os.unlink(destination)
+        extend_file(source, destination, sizes)
+    print(f'Extended {len(args.files)} file(s) to {args.llm0}x{args.mmm0} in {args.out_dir}.')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
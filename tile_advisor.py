@@ -0,0 +1,208 @@
+import argparse
+import glob
+import os
+import sys
+
+from estimate_memory import evaluate_parameters, preprocess
+
+# Cache working sets of the hot routines for the sub-tiles of a rank.
+#
+# CROCO sweeps the horizontal loops of a routine over one sub-tile at a time, level by
+# level. Between the loops of one level a thread reuses its private 2D scratch arrays
+# (A2d(1,k,trd), N2d values each: t3dmix keeps its slopes and fluxes in A2d(1,1..5)) and
+# the 3D fields of the levels it touches, so that set of arrays is the working set that
+# has to stay in cache. Sub-tile arrays include the halo: size_XI = 7 + Lm/NSUB_X and
+# size_ETA = 7 + Mm/NSUB_E as in param.h, N2d = size_XI * max(size_ETA, N+1).
+#
+# The counts below are the arrays each routine touches per level in a regional
+# configuration (approximate, like the field counts of estimate_memory.py). A split is
+# cache-resident when the largest working set fits in CACHE_FILL of the L2 of a core,
+# or failing that of its share of the L3.
+
+BYTES_PER_VALUE = 8
+CACHE_FILL = 0.75
+MIN_SUBTILE = 8
+MAX_SUBTILES_PER_THREAD = 16
+
+# routine: (2D scratch arrays, 3D fields per level, levels touched, 2D fields, cppdefs key)
+ROUTINES = {
+    'step2d': (24, 0, 0, 20, None),
+    'pre_step3d': (8, 7, 2, 4, None),
+    'step3d_uv': (6, 6, 2, 4, None),
+    'step3d_t': (8, 6, 2, 4, None),
+    't3dmix': (5, 3, 2, 4, None),
+    'gls_mixing': (10, 8, 2, 2, 'GLS_MIXING'),
+}
+# Biology works on whole columns of one row of the sub-tile: all its tracers, all levels
+BIOLOGY_EXTRA_FIELDS = 4
+
+
+def cache_sizes(sys_cpu_dir='/sys/devices/system/cpu/cpu0/cache'):
+    """{level: (bytes, cpus sharing it)} of the data/unified caches of cpu0"""
+    sizes = {}
+    for index in sorted(glob.glob(os.path.join(sys_cpu_dir, 'index*'))):
+        try:
+            level = int(open(os.path.join(index, 'level')).read())
+            kind = open(os.path.join(index, 'type')).read().strip()
+            size = open(os.path.join(index, 'size')).read().strip()
+            shared = open(os.path.join(index, 'shared_cpu_list')).read().strip()
+        except (OSError, ValueError):
+            continue
+        if kind == 'Instruction':
+            continue
+        units = {'K': 1024, 'M': 1024 ** 2, 'G': 1024 ** 3}
+        value = int(size[:-1]) * units[size[-1]] if size[-1] in units else int(size)
+        cpus = 0
+        for part in shared.split(','):
+            low, _, high = part.partition('-')
+            cpus += int(high or low) - int(low) + 1
+        sizes[level] = (value, max(cpus, 1))
+    return sizes
+
+
+def defined_keys(cppdefs_file):
+    keys = set()
+    with open(cppdefs_file) as f:
+        for line in f:
+            words = line.split()
+            if len(words) >= 2 and words[0] == '#' and words[1] == 'define' and len(words) > 2:
+                keys.add(words[2])
+            elif words and words[0] == '#define' and len(words) > 1:
+                keys.add(words[1])
+    return keys
+
+
+def subtile_sizes(p, nsub_x, nsub_e):
+    """Interior and halo-padded sizes of a sub-tile, and N2d of the scratch arrays"""
+    inner_x = (p['lm'] + nsub_x - 1) // nsub_x
+    inner_e = (p['mm'] + nsub_e - 1) // nsub_e
+    size_xi, size_eta = 7 + inner_x, 7 + inner_e
+    n2d = size_xi * max(size_eta, p['n'] + 1)
+    return inner_x, inner_e, size_xi, size_eta, n2d
+
+
+def working_sets(p, keys, nsub_x, nsub_e):
+    """Bytes each routine keeps in use per level of one sub-tile"""
+    _, _, size_xi, size_eta, n2d = subtile_sizes(p, nsub_x, nsub_e)
+    points = size_xi * size_eta
+    sets = {}
+    for name, (scratch, fields_3d, levels, fields_2d, key) in ROUTINES.items():
+        if key and key not in keys:
+            continue
+        sets[name] = BYTES_PER_VALUE * (scratch * n2d + (fields_3d * levels + fields_2d) * points)
+    if 'BIOLOGY' in keys:
+        tracers = p.get('ntrc_bio', 0) or p.get('nt', 2)
+        sets['biology'] = BYTES_PER_VALUE * size_xi * p['n'] * (tracers + BIOLOGY_EXTRA_FIELDS)
+    return sets
+
+
+def candidates(p, threads):
+    """Splits with 1..MAX_SUBTILES_PER_THREAD sub-tiles per thread and sub-tiles of at least MIN_SUBTILE points"""
+    splits = []
+    for multiple in range(1, MAX_SUBTILES_PER_THREAD + 1):
+        count = threads * multiple
+        for nsub_x in range(1, count + 1):
+            if count % nsub_x:
+                continue
+            nsub_e = count // nsub_x
+            inner_x, inner_e, _, _, _ = subtile_sizes(p, nsub_x, nsub_e)
+            if inner_x >= MIN_SUBTILE and inner_e >= MIN_SUBTILE:
+                splits.append((nsub_x, nsub_e))
+    return splits
+
+
+def halo_overhead(p, nsub_x, nsub_e):
+    """Extra points of the halo-padded sub-tiles over the rank tile"""
+    _, _, size_xi, size_eta, _ = subtile_sizes(p, nsub_x, nsub_e)
+    return nsub_x * nsub_e * size_xi * size_eta / float(p['lm'] * p['mm']) - 1.0
+
+
+def recommend(p, keys, threads, budgets):
+    """The split with the fewest sub-tiles (least halo work) whose largest working set
+    fits the first budget it can fit, from L2 to L3; the smallest working set otherwise"""
+    options = candidates(p, threads)
+    if not options:
+        return None, None
+    scored = []
+    for nsub_x, nsub_e in options:
+        largest = max(working_sets(p, keys, nsub_x, nsub_e).values())
+        inner_x, inner_e = subtile_sizes(p, nsub_x, nsub_e)[:2]
+        squareness = abs(inner_x - inner_e)
+        scored.append((nsub_x * nsub_e, squareness, largest, nsub_x, nsub_e))
+    for name, budget in budgets:
+        fitting = [s for s in scored if s[2] <= budget]
+        if fitting:
+            best = min(fitting)
+            return (best[3], best[4]), name
+    best = min(scored, key=lambda s: (s[2], s[0]))
+    return (best[3], best[4]), None
+
+
+def megabytes(value):
+    return value / 2.0 ** 20
+
+
+def print_sets(title, p, keys, nsub_x, nsub_e, budgets):
+    inner_x, inner_e, size_xi, size_eta, _ = subtile_sizes(p, nsub_x, nsub_e)
+    print('%s: %dx%d sub-tiles of %dx%d points (%dx%d with halo, %.0f%% halo work)' % (
+        title, nsub_x, nsub_e, inner_x, inner_e, size_xi, size_eta, 100 * halo_overhead(p, nsub_x, nsub_e)))
+    for name, value in sorted(working_sets(p, keys, nsub_x, nsub_e).items(), key=lambda item: -item[1]):
+        fits = next((level for level, budget in budgets if value <= budget), 'memory')
+        print('    %-12s %9.2f MB  %s' % (name, megabytes(value), fits))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Sub-tile sizes that keep the working sets of CROCO in cache.')
+    parser.add_argument('--param', required=True)
+    parser.add_argument('--cppdefs', required=True)
+    parser.add_argument('--np-xi', type=int, default=1)
+    parser.add_argument('--np-eta', type=int, default=1)
+    parser.add_argument('--threads', type=int, default=1, help='OpenMP threads per rank')
+    parser.add_argument('--nsub-x', type=int, default=1, help='Current sub-tiles in xi')
+    parser.add_argument('--nsub-e', type=int, default=0, help='Current sub-tiles in eta (default: threads)')
+    parser.add_argument('--include', action='append', default=[])
+    parser.add_argument('--l2-kb', type=float, help='L2 per core (default: from /sys)')
+    parser.add_argument('--l3-kb', type=float, help='L3 share per core (default: from /sys)')
+    parser.add_argument('--quiet', action='store_true', help='print only "<nsub_x> <nsub_e>"')
+    args = parser.parse_args()
+
+    include_dirs = [d for d in args.include if os.path.isdir(d)]
+    p = evaluate_parameters(preprocess(args.param, args.cppdefs, args.np_xi, args.np_eta, include_dirs))
+    missing = [name for name in ('lm', 'mm', 'n') if name not in p]
+    if missing:
+        sys.exit('Error: could not evaluate %s from %s.' % (', '.join(missing), args.param))
+    keys = defined_keys(args.cppdefs)
+
+    caches = cache_sizes()
+    l2 = args.l2_kb * 1024 if args.l2_kb else caches.get(2, (0, 1))[0] / caches.get(2, (0, 1))[1]
+    l3 = args.l3_kb * 1024 if args.l3_kb else caches.get(3, (0, 1))[0] / caches.get(3, (0, 1))[1]
+    budgets = [(name, CACHE_FILL * size) for name, size in (('L2', l2), ('L3', l3)) if size > 0]
+    if not budgets:
+        sys.exit('Error: no cache sizes found in /sys; give them with --l2-kb/--l3-kb.')
+
+    nsub_e = args.nsub_e or args.threads
+    split, level = recommend(p, keys, args.threads, budgets)
+    if split is None:
+        sys.exit('Error: the %dx%d tiles of a rank are too small to split for %d threads.' % (p['lm'], p['mm'], args.threads))
+    if args.quiet:
+        print('%d %d' % split)
+        return 0
+
+    print('Grid: %d x %d x %d, decomposition %d x %d (%d x %d points per rank), %d thread(s) per rank' % (
+        p.get('llm', 0), p.get('mmm', 0), p['n'], args.np_xi, args.np_eta, p['lm'], p['mm'], args.threads))
+    print('Cache per core: ' + ', '.join('%s %.0f KB (%.0f KB usable)' % (name, budget / CACHE_FILL / 1024, budget / 1024)
+                                         for name, budget in budgets))
+    print_sets('Current', p, keys, args.nsub_x, nsub_e, budgets)
+    if split == (args.nsub_x, nsub_e):
+        print('The current split is the recommended one.')
+    else:
+        print_sets('Recommended', p, keys, split[0], split[1], budgets)
+    if level:
+        print('Recommended split: NSUB_X=%d NSUB_E=%d (working sets fit in %s)' % (split[0], split[1], level))
+    else:
+        print('Recommended split: NSUB_X=%d NSUB_E=%d (smallest working set; nothing fits in cache)' % split)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())